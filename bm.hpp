@@ -54,6 +54,27 @@
 // --benchmark_warmup=True (default is False)
 // --benchmark_repetitions={unsigned int} (default is 1)
 // --benchmark_min_time={unsigned float} (default is 0.1 seconds)
+// --benchmark_time_budget={unsigned float}s (default is 0, no budget)
+// --benchmark_isolation=process (default is none)
+// --benchmark_timeout={unsigned float}s (default is 0, no timeout)
+// --benchmark_pin_cpu={unsigned int} (default is unpinned)
+// --benchmark_huge_pages=True (default is the system's THP setting)
+//
+// With --benchmark_time_budget set, experiments no longer stop on their own.
+// Every experiment first runs kMinIterations times, then the rest of the budget
+// is handed out, a round at a time, to the experiment with the widest relative
+// 95% confidence interval. Suite time is then bounded by the budget (plus the
+// initial round if the budget is smaller than that).
+//
+// With --benchmark_isolation=process, each benchmark runs in its own forked
+// child so heap, page cache and code layout effects of one benchmark don't leak
+// into the next. Results come back to the parent over a pipe. A child that
+// crashes or runs past --benchmark_timeout is recorded as an error and the
+// remaining benchmarks still run. It can't be combined with
+// --benchmark_time_budget, which schedules experiments within one process.
+// --benchmark_pin_cpu pins the benchmarks to one CPU.
+// --benchmark_huge_pages=True advises transparent huge pages for the heap the
+// benchmarks allocate from, False disables them for the benchmark process.
 //
 // If a malformed flag is passed, benchmarks will not run.
 //
@@ -107,35 +128,166 @@
 // To prevent the re-ordering of instructions, use BM::DontReorder().
 // TODO: Prevent re-ordering with memory_order_acquire_release.
 //
+// Samples are read from a clock chosen at compile time with BM_CLOCK, e.g.
+// g++ -DBM_CLOCK=BM::MonotonicRawClock. There is no runtime dispatch unless
+// BM::AutoClock is chosen. Clocks:
+// BM::RdtscClock        cpuid + rdtsc. Default on x86.
+// BM::RdtscpClock       rdtscp + lfence. Cheaper than cpuid, still ordered.
+// BM::MonotonicRawClock clock_gettime(CLOCK_MONOTONIC_RAW), served by the vDSO.
+//                       Default elsewhere.
+// BM::SteadyClock       std::chrono::steady_clock.
+// BM::AutoClock         rdtsc if the TSC is reliable, else
+//                       clock_gettime(CLOCK_MONOTONIC_RAW). Picked at startup,
+//                       read through a function pointer.
+// At startup BM checks the TSC is invariant (cpuid) and is the kernel's
+// clocksource (sysfs). If it isn't, TSC based clocks warn and AutoClock falls
+// back.
+//
 
 #ifndef BM_H
 #define BM_H
 
+#if defined(__x86_64__) || defined(__i386__)
+#define BM_HAS_TSC 1
+#endif
+
 #include <bits/types/struct_timeval.h>
-#include <cpuid.h>
 #include <math.h>
+#include <malloc.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef BM_HAS_TSC
+#include <cpuid.h>
 #include <x86intrin.h>
+#endif
 
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace BM {
 
-// TODO: make pipeline flushing optional
-static int64_t ReadTSC() {
-  // call to cpuid ensures pipeline is flushed before reading the TSC register
-  __get_cpuid_max(0, nullptr);
-  return _rdtsc();
+// -----------------------------------------------------------------------------
+// Clocks
+// -----------------------------------------------------------------------------
+
+// A clock policy provides:
+//   static int64_t Now();  A sample. Only differences between samples matter.
+//   static const char *Unit();  What one tick of Now() is.
+//   static void Check(bool tsc_reliable, const std::string &reason);
+//     Called once at startup with the result of the TSC check.
+
+#ifdef BM_HAS_TSC
+static void WarnUnreliableTsc(const std::string &reason) {
+  std::cout << "Warning: " << reason
+            << ". rdtsc samples may be unreliable. Recommend compiling with "
+               "-DBM_CLOCK=BM::AutoClock or "
+               "-DBM_CLOCK=BM::MonotonicRawClock.\n";
+}
+
+struct RdtscClock {
+  static int64_t Now() {
+    // call to cpuid ensures pipeline is flushed before reading the TSC register
+    __get_cpuid_max(0, nullptr);
+    return _rdtsc();
+  }
+  static const char *Unit() { return "reference cycles"; }
+  static void Check(bool tsc_reliable, const std::string &reason) {
+    if (!tsc_reliable) WarnUnreliableTsc(reason);
+  }
+};
+
+struct RdtscpClock {
+  static int64_t Now() {
+    // rdtscp waits for earlier instructions, lfence holds back later ones
+    unsigned int aux;
+    int64_t tsc = __rdtscp(&aux);
+    _mm_lfence();
+    return tsc;
+  }
+  static const char *Unit() { return "reference cycles"; }
+  static void Check(bool tsc_reliable, const std::string &reason) {
+    if (!tsc_reliable) WarnUnreliableTsc(reason);
+  }
+};
+#endif  // BM_HAS_TSC
+
+struct MonotonicRawClock {
+  static int64_t Now() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  }
+  static const char *Unit() { return "nanoseconds"; }
+  static void Check(bool, const std::string &) {}
+};
+
+struct SteadyClock {
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+  static const char *Unit() { return "nanoseconds"; }
+  static void Check(bool, const std::string &) {}
+};
+
+// AutoClock's source, chosen by AutoClock::Check.
+#ifdef BM_HAS_TSC
+static int64_t (*AutoClockNow)() = RdtscClock::Now;
+static const char *AutoClockUnit = RdtscClock::Unit();
+#else
+static int64_t (*AutoClockNow)() = MonotonicRawClock::Now;
+static const char *AutoClockUnit = MonotonicRawClock::Unit();
+#endif
+
+struct AutoClock {
+  static int64_t Now() { return AutoClockNow(); }
+  static const char *Unit() { return AutoClockUnit; }
+  static void Check(bool tsc_reliable, const std::string &reason) {
+    if (tsc_reliable) return;
+    AutoClockNow = MonotonicRawClock::Now;
+    AutoClockUnit = MonotonicRawClock::Unit();
+    std::cout << "Warning: " << reason
+              << ". Falling back to clock_gettime(CLOCK_MONOTONIC_RAW).\n";
+  }
+};
+
+#ifndef BM_CLOCK
+#ifdef BM_HAS_TSC
+#define BM_CLOCK BM::RdtscClock
+#else
+#define BM_CLOCK BM::MonotonicRawClock
+#endif
+#endif
+typedef BM_CLOCK Clock;
+
+// Milliseconds since epoch, used for wall time.
+static long ReadWallTimeMs() {
+  timeval time_check;
+  gettimeofday(&time_check, nullptr);
+  return (long)time_check.tv_sec * 1000 + (long)time_check.tv_usec / 1000;
 }
 
 // -----------------------------------------------------------------------------
@@ -145,6 +297,11 @@ static int64_t ReadTSC() {
 static const std::string kOutputFileFormatFlag = "output_format";
 static const std::string kOutputFilePathFlag = "output_file";
 static const std::string kTestRootDirFlag = "test_root_dir";
+static const std::string kTimeBudgetFlag = "benchmark_time_budget";
+static const std::string kIsolationFlag = "benchmark_isolation";
+static const std::string kTimeoutFlag = "benchmark_timeout";
+static const std::string kPinCpuFlag = "benchmark_pin_cpu";
+static const std::string kHugePagesFlag = "benchmark_huge_pages";
 
 enum class OutputFormat {
   kUnknown,
@@ -166,6 +323,67 @@ static std::string OutputFormatToStr(const OutputFormat &format) {
   return kOutputFormatTypes.at(static_cast<size_t>(format));
 }
 
+// Parses a duration of the form {unsigned float}[s|ms] into seconds. A missing
+// suffix means seconds. Returns a negative value if the string is malformed.
+static double StrToSeconds(const char *duration_string) {
+  if (!duration_string) {
+    return -1;
+  }
+  char *suffix = nullptr;
+  double value = strtod(duration_string, &suffix);
+  if (suffix == duration_string || value < 0 || !std::isfinite(value)) {
+    return -1;
+  }
+  if (*suffix == '\0' || !strcmp(suffix, "s")) {
+    return value;
+  }
+  if (!strcmp(suffix, "ms")) {
+    return value / 1000;
+  }
+  return -1;
+}
+
+enum class Isolation {
+  kUnknown,
+  kNone,
+  kProcess,
+};
+
+static Isolation StrToIsolation(const char *isolation_string) {
+  if (!isolation_string) {
+    return Isolation::kUnknown;
+  }
+  if (!strcmp("none", isolation_string)) {
+    return Isolation::kNone;
+  }
+  if (!strcmp("process", isolation_string)) {
+    return Isolation::kProcess;
+  }
+  return Isolation::kUnknown;
+}
+
+enum class HugePages {
+  // Leave the system's transparent huge page setting alone
+  kDefault,
+  kOn,
+  kOff,
+};
+
+static HugePages StrToHugePages(const char *huge_pages_string) {
+  if (!huge_pages_string) {
+    return HugePages::kDefault;
+  }
+  if (!strcmp("True", huge_pages_string) ||
+      !strcmp("true", huge_pages_string)) {
+    return HugePages::kOn;
+  }
+  if (!strcmp("False", huge_pages_string) ||
+      !strcmp("false", huge_pages_string)) {
+    return HugePages::kOff;
+  }
+  return HugePages::kDefault;
+}
+
 // TODO(CORE): --benchmark_enable_random_interleaving=True (default is False)
 // TODO(CORE): --benchmark_warmup=True (default is False)
 // TODO(CORE): --benchmark_repetitions={unsigned int} (default is 1)
@@ -177,6 +395,16 @@ struct Options {
   std::string benchmark_binary_name_;
   BM::OutputFormat output_format_ = BM::OutputFormat::kUnknown;
   std::string output_file_path_ = "";
+  // --benchmark_time_budget: total seconds the scheduler may spend across all
+  // experiments. 0 means every experiment stops on its own.
+  double time_budget_seconds_ = 0;
+  BM::Isolation isolation_ = BM::Isolation::kNone;
+  // --benchmark_timeout: seconds an isolated benchmark may run before it is
+  // killed. 0 means no timeout.
+  double timeout_seconds_ = 0;
+  // --benchmark_pin_cpu: CPU to pin benchmarks to. Negative means unpinned.
+  int pin_cpu_ = -1;
+  BM::HugePages huge_pages_ = BM::HugePages::kDefault;
 
   // Testing only flags
   // --test_root_dir: By default, benchmarking library assumes system root is
@@ -214,6 +442,54 @@ struct Options {
     }
     const std::string *closest_candidate = nullptr;
     switch (*option_name) {
+      case 'b': {
+        closest_candidate = &kTimeBudgetFlag;
+        if (!strncmp(option_name, kTimeBudgetFlag.c_str(),
+                     kTimeBudgetFlag.size())) {
+          double seconds = StrToSeconds(option_value);
+          if (seconds < 0) {
+            return 2;
+          }
+          time_budget_seconds_ = seconds;
+          break;
+        }
+        if (!strncmp(option_name, kIsolationFlag.c_str(),
+                     kIsolationFlag.size())) {
+          isolation_ = StrToIsolation(option_value);
+          if (isolation_ == BM::Isolation::kUnknown) {
+            return 2;
+          }
+          break;
+        }
+        if (!strncmp(option_name, kTimeoutFlag.c_str(), kTimeoutFlag.size())) {
+          double seconds = StrToSeconds(option_value);
+          if (seconds < 0) {
+            return 2;
+          }
+          timeout_seconds_ = seconds;
+          break;
+        }
+        if (!strncmp(option_name, kPinCpuFlag.c_str(), kPinCpuFlag.size())) {
+          char *end = nullptr;
+          long cpu = strtol(option_value, &end, 10);
+          if (*end != '\0' || cpu < 0 || cpu >= CPU_SETSIZE) {
+            return 2;
+          }
+          pin_cpu_ = static_cast<int>(cpu);
+          break;
+        }
+        if (!strncmp(option_name, kHugePagesFlag.c_str(),
+                     kHugePagesFlag.size())) {
+          huge_pages_ = StrToHugePages(option_value);
+          if (huge_pages_ == BM::HugePages::kDefault) {
+            return 2;
+          }
+          break;
+        }
+        std::cout << "No flags matched for " << option_name << ". Maybe "
+                  << *closest_candidate << "?\n";
+        return 3;
+      }
       case 't': {
         // Because testing flags are optional, we won't set closest_candidate
         if (!strncmp(option_name, kTestRootDirFlag.c_str(),
@@ -253,12 +529,23 @@ struct Options {
     }
     return 0;
   }
+
+  // Validate checks flags that are only valid in combination, once all flags
+  // are inserted. Returns non zero value on error:
+  // 4: --benchmark_time_budget and --benchmark_isolation=process are both set
+  // Otherwise returns 0.
+  // TODO(REFACTOR): Maybe move closest candidate check to here instead of in
+  //  CLI parsing?
+  uint32_t Validate() const {
+    if (time_budget_seconds_ > 0 && isolation_ == BM::Isolation::kProcess) {
+      return 4;
+    }
+    return 0;
+  }
 };
 
 // Config stores values set via command line flags.
 // Config is correctly set by calling BM::Initialize(argc, argv).
-// TODO(REFACTOR): Add a Validate() method to Config to do all checks at once.
-//  Maybe move closest candidate check to here instead of in CLI parsing?
 static BM::Options Config;
 
 // -----------------------------------------------------------------------------
@@ -283,6 +570,54 @@ static const std::vector<BM::SystemCheck> kSysfsChecks{
      "for more accurate results."},
 };
 
+static const std::string kClocksourcePath =
+    "/sys/devices/system/clocksource/clocksource0/current_clocksource";
+
+// Prefixes an absolute sysfs path with --test_root_dir, if set.
+static std::string SysfsPath(const std::string &file_path) {
+  std::string path;
+  if (!Config.test_root_dir_.empty()) {
+    path = Config.test_root_dir_;
+    // We pop the last directory seperator because sysfs check paths always
+    // start with root (/).
+    if (path.back() == '/') {
+      path.pop_back();
+    }
+  }
+  path.append(file_path);
+  return path;
+}
+
+// The TSC is reliable if the CPU says it's invariant (ticks at a constant rate
+// through frequency and power state changes) and the kernel still uses it as
+// its clocksource. Linux switches away from the TSC when it finds it unstable
+// e.g. on some VMs. If the clocksource can't be read, we go by cpuid alone.
+// On false, reason says why.
+static bool TscIsReliable(std::string *reason) {
+#ifdef BM_HAS_TSC
+  unsigned int eax, ebx, ecx, edx;
+  // CPUID.80000007H:EDX[8] is the invariant TSC flag
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) {
+    *reason = "TSC is not invariant";
+    return false;
+  }
+  std::ifstream clocksource_file(SysfsPath(kClocksourcePath), std::ios::in);
+  if (!clocksource_file.is_open()) {
+    return true;
+  }
+  std::string clocksource;
+  clocksource_file >> clocksource;
+  if (clocksource != "tsc") {
+    *reason = "TSC is not the kernel clocksource (using " + clocksource + ")";
+    return false;
+  }
+  return true;
+#else
+  *reason = "No TSC on this architecture";
+  return false;
+#endif
+}
+
 // -----------------------------------------------------------------------------
 // Control and telemetry
 // -----------------------------------------------------------------------------
@@ -290,9 +625,10 @@ static const std::vector<BM::SystemCheck> kSysfsChecks{
 struct Experiment {
   std::string label_ = "";
   Experiment *next_ = nullptr;
-  // CPU Time and Running mean are measured in CPU clock cycles, as returned by
-  // rdtsc. Please check your system CPU's manual/reference/programming guide
-  // for the relationship between advertised frequency and tsc frequency.
+  // CPU Time and Running mean are measured in BM::Clock::Unit(). For rdtsc
+  // clocks that's reference cycles. Please check your system CPU's
+  // manual/reference/programming guide for the relationship between advertised
+  // frequency and tsc frequency.
   // TODO(UI): add sysfs check for reference frequency and return nanosecond
   //  measurement from that.
   int64_t cpu_time_;
@@ -301,9 +637,13 @@ struct Experiment {
   int64_t mean_ = 0;
   int64_t squared_distance_from_mean_ = 0;
   int64_t variance_ = 0;
-  // Wall times are in milliseconds
-  long start_wall_time_;
-  long end_wall_time_;
+  // Wall times are in milliseconds. An experiment may be run in several rounds
+  // (see --benchmark_time_budget), so wall_time_ accumulates across rounds.
+  long start_wall_time_ = 0;
+  long wall_time_ = 0;
+  // If non zero, the experiment stops once iterations_ reaches this value
+  // instead of when its mean settles. Set by the time budget scheduler.
+  int64_t iteration_limit_ = 0;
   // Negative samples may occur when a BM is interrupted and rescheduled on a
   // different chip core.
   int64_t negative_sample_count_ = 0;
@@ -317,39 +657,43 @@ struct Experiment {
 static int64_t kMinIterations = 100;
 static int64_t kMaxIterations = 1000000000000;
 
-struct ExperimentIterator {
-  Experiment *previous_experiment_;
-  Experiment *current_experiment_;
+// Half width of the 95% confidence interval of the mean, in BM::Clock::Unit().
+static double ConfidenceInterval(const Experiment &e) {
+  if (e.iterations_ <= 0) return std::numeric_limits<double>::infinity();
+  return 1.96 * std::sqrt(static_cast<double>(e.variance_) / e.iterations_);
+}
 
-  ExperimentIterator() = default;
+// Confidence interval as a fraction of the mean. Experiments we know nothing
+// about yet are infinitely imprecise.
+static double RelativeConfidenceInterval(const Experiment &e) {
+  if (e.mean_ <= 0) return std::numeric_limits<double>::infinity();
+  return ConfidenceInterval(e) / e.mean_;
+}
 
-  ExperimentIterator(Experiment *experiment) : current_experiment_(experiment) {
-    // We initialize cpu_time_ here to provide a basis for subsequent rdtsc
-    // samples
-    current_experiment_->cpu_time_ = BM::ReadTSC();
-    timeval time_check;
-    gettimeofday(&time_check, nullptr);
-    current_experiment_->start_wall_time_ =
-        (long)time_check.tv_sec * 1000 + (long)time_check.tv_usec / 1000;
-  }
+// ClockPolicy is one of the clocks above. See BM_CLOCK.
+template <typename ClockPolicy>
+struct BasicExperimentIterator {
+  Experiment *previous_experiment_ = nullptr;
+  Experiment *current_experiment_ = nullptr;
 
-  ~ExperimentIterator() {
-    if (previous_experiment_ && !current_experiment_) {
-      timeval time_check;
-      gettimeofday(&time_check, nullptr);
-      previous_experiment_->end_wall_time_ =
-          (long)time_check.tv_sec * 1000 + (long)time_check.tv_usec / 1000;
-    }
+  BasicExperimentIterator() = default;
+
+  BasicExperimentIterator(Experiment *experiment)
+      : current_experiment_(experiment) {
+    // We initialize cpu_time_ here to provide a basis for subsequent clock
+    // samples
+    current_experiment_->start_wall_time_ = BM::ReadWallTimeMs();
+    current_experiment_->cpu_time_ = ClockPolicy::Now();
   }
 
   // We only shift experiment pointer if we've gathered enough samples
-  ExperimentIterator operator++() {
+  BasicExperimentIterator operator++() {
     // TODO(OPTIONAL): additional heuristics that might be useful
     // - minimum_time < cpu_time
     // - 5*minimum_time < real_time
-    // We measure rdtsc before and after any statistics work to ensure library
+    // We read the clock before and after any statistics work to ensure library
     // statistics work doesn't muddle user results.
-    int64_t tsc_now = BM::ReadTSC();
+    int64_t tsc_now = ClockPolicy::Now();
     if (!current_experiment_) return *this;
     // Discard negative samples
     if (tsc_now < current_experiment_->cpu_time_) {
@@ -365,38 +709,58 @@ struct ExperimentIterator {
     current_experiment_->variance_ =
         current_experiment_->squared_distance_from_mean_ /
         current_experiment_->iterations_;
-    current_experiment_->cpu_time_ = BM::ReadTSC();
-    if (current_experiment_->iterations_ > kMinIterations) {
+    current_experiment_->cpu_time_ = ClockPolicy::Now();
+    if (current_experiment_->iteration_limit_) {
+      // The scheduler runs one experiment per round, so we don't move on to
+      // the next one.
+      if (current_experiment_->iterations_ >=
+          current_experiment_->iteration_limit_) {
+        Finish(nullptr);
+      }
+    } else if (current_experiment_->iterations_ > kMinIterations) {
       if (std::fabs(sample - current_experiment_->mean_) <
               (1.96 * std::sqrt(current_experiment_->variance_ /
                                 current_experiment_->iterations_)) ||
           (current_experiment_->iterations_ > kMaxIterations)) {
-        previous_experiment_ = current_experiment_;
-        current_experiment_ = current_experiment_->next_;
+        Finish(current_experiment_->next_);
       }
     }
     return *this;
   }
 
-  const ExperimentIterator operator++(int) {
-    ExperimentIterator it = *this;
+  // Closes the current experiment's wall time and moves on to next.
+  void Finish(Experiment *next) {
+    current_experiment_->wall_time_ +=
+        BM::ReadWallTimeMs() - current_experiment_->start_wall_time_;
+    previous_experiment_ = current_experiment_;
+    current_experiment_ = next;
+    if (current_experiment_) {
+      current_experiment_->start_wall_time_ = BM::ReadWallTimeMs();
+      current_experiment_->cpu_time_ = ClockPolicy::Now();
+    }
+  }
+
+  const BasicExperimentIterator operator++(int) {
+    BasicExperimentIterator it = *this;
     ++(*this);
     return it;
   }
 
   Experiment *operator*() { return current_experiment_; }
 
-  friend bool operator==(const ExperimentIterator &left,
-                         const ExperimentIterator &right) {
+  friend bool operator==(const BasicExperimentIterator &left,
+                         const BasicExperimentIterator &right) {
     return left.current_experiment_ == right.current_experiment_;
   }
 
-  friend bool operator!=(const ExperimentIterator &left,
-                         const ExperimentIterator &right) {
+  friend bool operator!=(const BasicExperimentIterator &left,
+                         const BasicExperimentIterator &right) {
     return left.current_experiment_ != right.current_experiment_;
   }
 };
 
+typedef BasicExperimentIterator<BM::Clock> ExperimentIterator;
+
 struct ExperimentResult {
   ExperimentResult(const Experiment *e) {
     if (!e) return;
@@ -405,7 +769,8 @@ struct ExperimentResult {
     iterations_ = e->iterations_;
     mean_ = e->mean_;
     variance_ = e->variance_;
-    wall_time_ = e->end_wall_time_ - e->start_wall_time_;
+    confidence_interval_ = ConfidenceInterval(*e);
+    wall_time_ = e->wall_time_;
     negative_sample_count_ = e->negative_sample_count_;
   }
   std::string name_;
@@ -413,18 +778,32 @@ struct ExperimentResult {
   int64_t iterations_ = 0;
   int64_t mean_ = 0;
   int64_t variance_ = 0;
+  // Half width of the 95% confidence interval of mean_
+  double confidence_interval_ = 0;
   int64_t wall_time_ = 0;
   int64_t negative_sample_count_ = 0;
+  // Non empty if the benchmark did not produce results e.g. its isolated
+  // process crashed or timed out.
+  std::string error_;
 };
 
 static std::vector<BM::ExperimentResult> Results;
 
+// Seconds spent running experiments under --benchmark_time_budget.
+static double TimeBudgetUsedSeconds = 0;
+
 struct Controller {
   Controller() = default;
 
   Experiment *experiment_list_ = nullptr;
+  // If set, iteration starts from this experiment instead of the head of
+  // experiment_list_. Used by the time budget scheduler.
+  Experiment *scheduled_experiment_ = nullptr;
 
-  ExperimentIterator begin() { return ExperimentIterator(experiment_list_); }
+  ExperimentIterator begin() {
+    return ExperimentIterator(scheduled_experiment_ ? scheduled_experiment_
+                                                    : experiment_list_);
+  }
   ExperimentIterator end() { return ExperimentIterator(); }
 
   void ConstructExperiments(const std::string &name) {
@@ -455,8 +834,19 @@ struct Benchmark {
   Benchmark(const std::string &name, BM::Function *function)
       : name_(name), function_(function) {}
 
-  // Populates experiments, following controller_'s configuration
-  void Setup() { controller_.ConstructExperiments(name_); }
+  // Populates experiments, following controller_'s configuration. Does nothing
+  // if they are already populated.
+  void Setup() {
+    if (!controller_.experiment_list_) controller_.ConstructExperiments(name_);
+  }
+
+  int64_t ExperimentCount() const {
+    int64_t count = 0;
+    for (Experiment *e = controller_.experiment_list_; e; e = e->next_) {
+      ++count;
+    }
+    return count;
+  }
 
   // Writes Counters to results map
   void TearDown() { controller_.WriteExperimentResults(); }
@@ -499,17 +889,20 @@ static void Initialize(int argc, char **argv) {
       }
     }
   }
-  for (size_t i = 0; i < kSysfsChecks.size(); ++i) {
-    std::string path;
-    if (!Config.test_root_dir_.empty()) {
-      path = Config.test_root_dir_;
-      // We pop the last directory seperator because sysfs check paths always
-      // start with root (/).
-      if (path.back() == '/') {
-        path.pop_back();
-      }
+  switch (BM::Config.Validate()) {
+    case 4: {
+      std::cout << "Error with flags --" << kTimeBudgetFlag << " and --"
+                << kIsolationFlag
+                << "=process. A time budget can't be scheduled across "
+                   "isolated processes\n";
+      exit(1);
+    }
+    default: {
+      break;
     }
-    path.append(kSysfsChecks[i].file_path_);
+  }
+  for (size_t i = 0; i < kSysfsChecks.size(); ++i) {
+    std::string path = SysfsPath(kSysfsChecks[i].file_path_);
     // TODO(REFACTOR): any_test_flag_set_ is used during testing to see if flags
     // are properly set. Perhaps we want to replace with some sort of global
     // --log_error or --log_verbosity=TESTING.
@@ -531,17 +924,364 @@ static void Initialize(int argc, char **argv) {
     }
     sys_file.close();
   }
+  std::string unreliable_tsc_reason;
+  bool tsc_reliable = TscIsReliable(&unreliable_tsc_reason);
+  BM::Clock::Check(tsc_reliable, unreliable_tsc_reason);
 }
 
 // -----------------------------------------------------------------------------
 // Execution
 // -----------------------------------------------------------------------------
 
+// Fraction of the time budget handed out to an experiment per round. Smaller
+// rounds track the widest confidence interval more closely but call back into
+// the benchmark function more often.
+static const double kTimeBudgetRoundFraction = 0.05;
+
+// An experiment as tracked by the time budget scheduler.
+struct Scheduled {
+  BM::Benchmark *benchmark_;
+  BM::Experiment *experiment_;
+  double seconds_per_iteration_;
+  // Set when a round made no progress e.g. the benchmark function never
+  // iterates over its controller.
+  bool exhausted_;
+};
+
+// Returns the experiment in schedule that gets the next round: the one with the
+// widest relative confidence interval that isn't exhausted. Ties go to the
+// earliest. Returns nullptr if every experiment is exhausted.
+static BM::Scheduled *PickWidest(std::vector<BM::Scheduled> &schedule) {
+  BM::Scheduled *widest = nullptr;
+  double widest_ci = -1;
+  for (auto &s : schedule) {
+    if (s.exhausted_) continue;
+    double ci = RelativeConfidenceInterval(*s.experiment_);
+    if (ci > widest_ci) {
+      widest = &s;
+      widest_ci = ci;
+    }
+  }
+  return widest;
+}
+
+// Runs every experiment kMinIterations times, then repeatedly gives a round of
+// iterations to the experiment with the widest relative confidence interval
+// until budget seconds run out.
+static void RunWithTimeBudget(const std::vector<BM::Benchmark *> &benchmarks,
+                              double budget) {
+  std::vector<Scheduled> schedule;
+  for (auto b : benchmarks) {
+    b->Setup();
+    for (Experiment *e = b->controller_.experiment_list_; e; e = e->next_) {
+      schedule.push_back({b, e, 0, false});
+    }
+  }
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  auto run_round = [](Scheduled &s, int64_t iterations) {
+    s.experiment_->iteration_limit_ = s.experiment_->iterations_ + iterations;
+    s.benchmark_->controller_.scheduled_experiment_ = s.experiment_;
+    int64_t iterations_before = s.experiment_->iterations_;
+    std::chrono::steady_clock::time_point round_start =
+        std::chrono::steady_clock::now();
+    s.benchmark_->function_(s.benchmark_->controller_);
+    std::chrono::duration<double> round_time =
+        std::chrono::steady_clock::now() - round_start;
+    int64_t ran = s.experiment_->iterations_ - iterations_before;
+    if (ran <= 0) {
+      s.exhausted_ = true;
+      return;
+    }
+    s.seconds_per_iteration_ = round_time.count() / ran;
+  };
+  for (auto &s : schedule) {
+    run_round(s, kMinIterations);
+  }
+  while (true) {
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - start;
+    double remaining = budget - used.count();
+    if (remaining <= 0) break;
+    Scheduled *widest = PickWidest(schedule);
+    if (!widest) break;
+    double round_seconds =
+        std::fmin(remaining, budget * kTimeBudgetRoundFraction);
+    int64_t iterations = 1;
+    if (widest->seconds_per_iteration_ > 0) {
+      iterations = std::max<int64_t>(
+          1, static_cast<int64_t>(round_seconds /
+                                  widest->seconds_per_iteration_));
+    }
+    run_round(*widest, iterations);
+  }
+  std::chrono::duration<double> used =
+      std::chrono::steady_clock::now() - start;
+  TimeBudgetUsedSeconds = used.count();
+  for (auto b : benchmarks) {
+    b->controller_.scheduled_experiment_ = nullptr;
+    b->TearDown();
+  }
+}
+
+// Runs benchmarks in this process, under a time budget if one is set.
+static void RunBenchmarks(const std::vector<BM::Benchmark *> &benchmarks,
+                          double budget) {
+  if (budget > 0) {
+    RunWithTimeBudget(benchmarks, budget);
+    return;
+  }
+  for (auto b : benchmarks) {
+    b->Setup();
+    b->function_(b->controller_);
+    b->TearDown();
+  }
+}
+
+// Heap reserved up front and advised for huge pages under
+// --benchmark_huge_pages=True. Allocations beyond this are left to the kernel.
+static const size_t kHugePageHeapReserve = 64 << 20;
+static const uintptr_t kHugePageSize = 2 << 20;
+
+static void PinToCpu(int cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+    std::cout << "Warning: Failed to pin to CPU " << cpu << ": "
+              << strerror(errno) << '\n';
+  }
+}
+
+// Applies --benchmark_huge_pages to the heap of the process benchmarks run in.
+// malloc is told to grow the heap by kHugePageHeapReserve and serve large
+// allocations from it rather than from mmap, so the advised range covers what
+// the benchmarks will allocate.
+static void ApplyHugePages(BM::HugePages huge_pages) {
+  switch (huge_pages) {
+    case BM::HugePages::kOn: {
+      uintptr_t heap_start = reinterpret_cast<uintptr_t>(sbrk(0));
+      mallopt(M_MMAP_THRESHOLD, kHugePageHeapReserve);
+      mallopt(M_TOP_PAD, kHugePageHeapReserve);
+      mallopt(M_TRIM_THRESHOLD, 2 * kHugePageHeapReserve);
+      // Below the mmap threshold, so this grows the heap by at least
+      // kHugePageHeapReserve. The trim threshold keeps it there after free.
+      free(malloc(kHugePageHeapReserve / 2));
+      uintptr_t heap_end = reinterpret_cast<uintptr_t>(sbrk(0));
+      uintptr_t advise_start =
+          (heap_start + kHugePageSize - 1) & ~(kHugePageSize - 1);
+      uintptr_t advise_end = heap_end & ~(kHugePageSize - 1);
+      if (advise_end <= advise_start ||
+          madvise(reinterpret_cast<void *>(advise_start),
+                  advise_end - advise_start, MADV_HUGEPAGE)) {
+        std::cout << "Warning: Failed to advise huge pages for the heap\n";
+      }
+      break;
+    }
+    case BM::HugePages::kOff: {
+      if (prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0)) {
+        std::cout << "Warning: Failed to disable transparent huge pages: "
+                  << strerror(errno) << '\n';
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+// Fixed size part of an ExperimentResult as sent from an isolated benchmark to
+// the parent. It is followed by name_size bytes of the result's name. Both ends
+// are the same binary so we send it in native layout.
+struct WireResult {
+  int64_t name_size_;
+  int64_t cpu_time_;
+  int64_t iterations_;
+  int64_t mean_;
+  int64_t variance_;
+  double confidence_interval_;
+  int64_t wall_time_;
+  int64_t negative_sample_count_;
+};
+
+static void AppendWireResult(const BM::ExperimentResult &r, std::string *out) {
+  WireResult w;
+  w.name_size_ = r.name_.size();
+  w.cpu_time_ = r.cpu_time_;
+  w.iterations_ = r.iterations_;
+  w.mean_ = r.mean_;
+  w.variance_ = r.variance_;
+  w.confidence_interval_ = r.confidence_interval_;
+  w.wall_time_ = r.wall_time_;
+  w.negative_sample_count_ = r.negative_sample_count_;
+  out->append(reinterpret_cast<const char *>(&w), sizeof(w));
+  out->append(r.name_);
+}
+
+// Appends every result in buffer to parsed. Returns how many results this call
+// parsed, or -1 if buffer is truncated or malformed.
+static int64_t ParseWireResults(const std::string &buffer,
+                                std::vector<BM::ExperimentResult> *parsed) {
+  int64_t count = 0;
+  size_t offset = 0;
+  while (offset < buffer.size()) {
+    WireResult w;
+    if (buffer.size() - offset < sizeof(w)) return -1;
+    memcpy(&w, buffer.data() + offset, sizeof(w));
+    offset += sizeof(w);
+    if (w.name_size_ < 0 ||
+        buffer.size() - offset < static_cast<size_t>(w.name_size_)) {
+      return -1;
+    }
+    BM::ExperimentResult r(nullptr);
+    r.name_ = buffer.substr(offset, w.name_size_);
+    offset += w.name_size_;
+    r.cpu_time_ = w.cpu_time_;
+    r.iterations_ = w.iterations_;
+    r.mean_ = w.mean_;
+    r.variance_ = w.variance_;
+    r.confidence_interval_ = w.confidence_interval_;
+    r.wall_time_ = w.wall_time_;
+    r.negative_sample_count_ = w.negative_sample_count_;
+    parsed->push_back(r);
+    ++count;
+  }
+  return count;
+}
+
+static bool WriteAll(int fd, const char *data, size_t size) {
+  while (size) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Runs b in a forked child. The child sends its results back over a pipe and
+// the parent records them, or records an error if the child crashed, timed out
+// or could not be started.
+static void RunIsolated(BM::Benchmark *b) {
+  BM::ExperimentResult failure(nullptr);
+  failure.name_ = b->name_;
+  // Set up in the parent so we know how many results to expect. The child
+  // inherits the experiments.
+  b->Setup();
+  const int64_t expected_results = b->ExperimentCount();
+  int fds[2];
+  if (pipe(fds)) {
+    failure.error_ = std::string("failed to create pipe: ") + strerror(errno);
+    Results.push_back(failure);
+    return;
+  }
+  // Anything buffered now would otherwise be written by both processes.
+  std::cout.flush();
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    failure.error_ = std::string("failed to fork: ") + strerror(errno);
+    close(fds[0]);
+    close(fds[1]);
+    Results.push_back(failure);
+    return;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    ApplyHugePages(Config.huge_pages_);
+    size_t results_before = Results.size();
+    RunBenchmarks({b}, 0);
+    std::string buffer;
+    for (size_t i = results_before; i < Results.size(); ++i) {
+      AppendWireResult(Results[i], &buffer);
+    }
+    bool sent = WriteAll(fds[1], buffer.data(), buffer.size());
+    close(fds[1]);
+    std::cout.flush();
+    fflush(stdout);
+    // _exit so the child doesn't run the parent's static destructors
+    _exit(sent ? 0 : 1);
+  }
+  close(fds[1]);
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(Config.timeout_seconds_));
+  std::string buffer;
+  bool timed_out = false;
+  char chunk[4096];
+  while (true) {
+    int timeout_ms = -1;
+    if (Config.timeout_seconds_ > 0) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      timeout_ms = std::max<int64_t>(0, remaining.count());
+    }
+    pollfd p = {fds[0], POLLIN, 0};
+    int ready = poll(&p, 1, timeout_ms);
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready == 0) {
+      timed_out = true;
+      kill(pid, SIGKILL);
+      break;
+    }
+    ssize_t n = ready < 0 ? -1 : read(fds[0], chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    buffer.append(chunk, n);
+  }
+  close(fds[0]);
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  if (timed_out) {
+    std::ostringstream error;
+    error << "timed out after " << Config.timeout_seconds_ << " seconds";
+    failure.error_ = error.str();
+  } else if (WIFSIGNALED(status)) {
+    failure.error_ = "crashed with signal " + std::to_string(WTERMSIG(status)) +
+                     " (" + strsignal(WTERMSIG(status)) + ")";
+  } else if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+    failure.error_ =
+        "exited with status " + std::to_string(WEXITSTATUS(status));
+  } else {
+    std::vector<BM::ExperimentResult> parsed;
+    int64_t parsed_count = ParseWireResults(buffer, &parsed);
+    if (parsed_count < 0) {
+      failure.error_ = "sent malformed results";
+    } else if (parsed_count == 0) {
+      failure.error_ = "exited without sending results";
+    } else if (parsed_count != expected_results) {
+      failure.error_ = "sent " + std::to_string(parsed_count) +
+                       " results, expected " + std::to_string(expected_results);
+    } else {
+      Results.insert(Results.end(), parsed.begin(), parsed.end());
+    }
+  }
+  if (!failure.error_.empty()) {
+    Results.push_back(failure);
+  }
+}
+
 static void Run() {
+  if (Config.pin_cpu_ >= 0) {
+    PinToCpu(Config.pin_cpu_);
+  }
+  if (Config.isolation_ != BM::Isolation::kProcess) {
+    ApplyHugePages(Config.huge_pages_);
+    std::vector<BM::Benchmark *> benchmarks;
+    for (auto &b : Benchmarks) {
+      benchmarks.push_back(&b);
+    }
+    RunBenchmarks(benchmarks, Config.time_budget_seconds_);
+    return;
+  }
   for (auto &b : Benchmarks) {
-    b.Setup();
-    b.function_(b.controller_);
-    b.TearDown();
+    RunIsolated(&b);
   }
 }
 
@@ -563,6 +1303,10 @@ static void ShutDown() {
   if (Config.output_format_ != BM::OutputFormat::kUnknown) {
     out << "Format: " << OutputFormatToStr(Config.output_format_) << ". ";
   }
+  if (Config.time_budget_seconds_ > 0) {
+    out << "Time budget: " << Config.time_budget_seconds_ << " seconds, used "
+        << TimeBudgetUsedSeconds << " seconds. ";
+  }
   std::string delim = " ";
   switch (Config.output_format_) {
     case (BM::OutputFormat::kText): {
@@ -575,11 +1319,18 @@ static void ShutDown() {
   // TODO: change to table
   // TODO: CSV, JSON format
   out << '\n';
+  const std::string unit = std::string(" ") + BM::Clock::Unit() + '\n';
   for (const auto &r : Results) {
+    if (!r.error_.empty()) {
+      out << "Name" << delim << r.name_ << '\n'
+          << "Error" << delim << r.error_ << '\n';
+      continue;
+    }
     out << "Name" << delim << r.name_ << '\n'
-        << "CPU Time" << delim << r.mean_ << " reference cycles\n"
-        << "Variance" << delim << r.variance_ << " reference cycles\n"
-        << "StDev" << delim << std::sqrt(r.variance_) << " reference cycles\n"
+        << "CPU Time" << delim << r.mean_ << unit
+        << "Variance" << delim << r.variance_ << unit
+        << "StDev" << delim << std::sqrt(r.variance_) << unit
+        << "95% CI" << delim << "+/- " << r.confidence_interval_ << unit
         << "Wall Time" << delim << r.wall_time_ << " milliseconds\n"
         << "Iterations" << delim << r.iterations_ << '\n';
     if (r.negative_sample_count_)
@@ -0,0 +1,13 @@
+// Compiled once per clock policy with -DBM_CLOCK. See CMakeLists.txt.
+#include "bm.hpp"
+
+static void BM_VecPush(BM::Controller &c) {
+  std::vector<int> v;
+  for (auto _ : c) {
+    v.push_back(1);
+  }
+}
+
+BM_Register(BM_VecPush);
+
+BM_Main();
@@ -0,0 +1,67 @@
+# Test Clock Integration
+# Expects a binary compiled with -DBM_CLOCK=BM::AutoClock
+
+from dataclasses import dataclass
+import os
+from pathlib import Path
+import re
+import subprocess
+import sys
+import tempfile
+
+
+@dataclass
+class Test:
+    name: str
+    clocksource: str
+    want_regexp_stdout: list[str]
+
+
+CLOCKSOURCE_FILE = "sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+TEST_COUNT = 1
+TESTS = [
+    Test(
+        "TestAutoClockFallsBackWhenTscIsNotClocksource",
+        "hpet",
+        [
+            "Warning: .*Falling back to clock_gettime",
+            "CPU Time [1-9]\\d* nanoseconds",
+        ],
+    ),
+]
+
+
+def test_clock():
+    if len(sys.argv) != 2:
+        print(
+            "ERROR: wrong number of args. " "Only one arg expected: path/to/executable"
+        )
+        return -1
+    binary_under_test = sys.argv[1]
+    print(f"Test Clock Integration. Using binary: {binary_under_test}")
+    passed = 0
+    test_tmp_dir = tempfile.mkdtemp()
+    for t in TESTS:
+        test_file_loc = os.path.join(test_tmp_dir, CLOCKSOURCE_FILE)
+        Path(test_file_loc).parent.mkdir(parents=True, exist_ok=True)
+        Path(test_file_loc).write_text(t.clocksource)
+        test_call = [binary_under_test, "--test_root_dir=" + test_tmp_dir]
+        test_run = subprocess.run(test_call, capture_output=True)
+        got_stdout = test_run.stdout.decode()
+        missing = [w for w in t.want_regexp_stdout if not re.search(w, got_stdout)]
+        if missing:
+            print(
+                f"Failed test {t.name}."
+                f" {test_call} got [{got_stdout}]."
+                f" Missing: {missing}."
+            )
+        else:
+            passed += 1
+        os.remove(test_file_loc)
+    print(f"Test Clock Integration. Passed {passed} out of {TEST_COUNT}")
+    return 0
+
+
+if __name__ == "__main__":
+    test_clock()
@@ -0,0 +1,36 @@
+# Test Clock Unit Integration
+# Expects a binary compiled with -DBM_CLOCK set to the clock under test and the
+# unit that clock reports in.
+
+import re
+import subprocess
+import sys
+
+
+def test_clock_unit():
+    if len(sys.argv) != 3:
+        print(
+            "ERROR: wrong number of args. "
+            "Two args expected: path/to/executable unit"
+        )
+        return -1
+    binary_under_test = sys.argv[1]
+    unit = sys.argv[2]
+    print(f"Test Clock Unit Integration. Using binary: {binary_under_test}")
+    test_run = subprocess.run([binary_under_test], capture_output=True)
+    got_stdout = test_run.stdout.decode()
+    want = f"CPU Time [1-9]\\d* {unit}\n"
+    if not re.search(want, got_stdout):
+        print(
+            f"Failed test TestCpuTimeInUnit."
+            f" {binary_under_test} got [{got_stdout}]."
+            f" Did not match [{want}]."
+        )
+        print("Test Clock Unit Integration. Passed 0 out of 1")
+        return 0
+    print("Test Clock Unit Integration. Passed 1 out of 1")
+    return 0
+
+
+if __name__ == "__main__":
+    test_clock_unit()
@@ -12,13 +12,33 @@ class Test:
     want_output: str
 
 
-TEST_COUNT = 5
+TEST_COUNT = 9
 TESTS = [
     Test("TestNoFlagsIsOkay", [""], ""),
     Test("TestInvalidFlagName", ["--=test"], "Error with flag"),
     Test("TestSetInvalidTestRootDir", ["--test_root_dir"], "Error with flag"),
     Test("TestSetTestRootWithNoDir", ["--test_root_dir="], "Error with flag"),
     Test("TestSetTestRootDir", ["--test_root_dir=/path"], "FLAG SET"),
+    Test(
+        "TestSetInvalidTimeBudget",
+        ["--benchmark_time_budget=1h"],
+        "Error with flag",
+    ),
+    Test(
+        "TestSetTimeBudget",
+        ["--benchmark_time_budget=10ms"],
+        "Time budget: 0.01",
+    ),
+    Test(
+        "TestSetInvalidIsolation",
+        ["--benchmark_isolation=thread"],
+        "Error with flag",
+    ),
+    Test(
+        "TestTimeBudgetWithIsolationFails",
+        ["--benchmark_time_budget=10ms", "--benchmark_isolation=process"],
+        "Error with flags --benchmark_time_budget and --benchmark_isolation",
+    ),
 ]
 
 
@@ -0,0 +1,86 @@
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "bm.hpp"
+
+static void BM_Crash(BM::Controller &c) {
+  for (auto _ : c) {
+    raise(SIGSEGV);
+  }
+}
+
+BM_Register(BM_Crash);
+
+static void BM_Hang(BM::Controller &c) {
+  volatile bool spin = true;
+  for (auto _ : c) {
+    while (spin) {
+    }
+  }
+}
+
+BM_Register(BM_Hang);
+
+static void BM_Exit(BM::Controller &c) {
+  for (auto _ : c) {
+    exit(0);
+  }
+}
+
+BM_Register(BM_Exit);
+
+static void BM_VecPush(BM::Controller &c) {
+  std::vector<int> v;
+  for (auto _ : c) {
+    v.push_back(1);
+  }
+}
+
+BM_Register(BM_VecPush);
+
+// True if any [heap] mapping in /proc/self/smaps is advised for huge pages
+// ("hg" in its VmFlags).
+static bool HeapAdvisedForHugePages() {
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool in_heap = false;
+  while (std::getline(smaps, line)) {
+    if (line.compare(0, 8, "VmFlags:") == 0) {
+      if (in_heap && (line + ' ').find(" hg ") != std::string::npos) {
+        return true;
+      }
+      in_heap = false;
+    } else if (line.find("[heap]") != std::string::npos) {
+      in_heap = true;
+    }
+  }
+  return false;
+}
+
+// Prints the state the isolated child was set up with so tests can check the
+// flags took effect.
+static void BM_ProcessState(BM::Controller &c) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  sched_getaffinity(0, sizeof(cpus), &cpus);
+  std::cout << "CPU affinity:";
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpus)) std::cout << ' ' << cpu;
+  }
+  std::cout << '\n'
+            << "THP disabled: " << prctl(PR_GET_THP_DISABLE, 0, 0, 0, 0) << '\n'
+            << "Heap advised for huge pages: "
+            << (HeapAdvisedForHugePages() ? "yes" : "no") << '\n';
+  for (auto _ : c) {
+  }
+}
+
+BM_Register(BM_ProcessState);
+
+BM_Main();
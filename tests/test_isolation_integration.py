@@ -0,0 +1,97 @@
+# Test Isolation Integration
+# Benchmarks in test_isolation.cc crash and hang. They should only ever be run
+# with --benchmark_isolation=process and a --benchmark_timeout.
+
+from dataclasses import dataclass
+import subprocess
+import sys
+
+
+@dataclass
+class Test:
+    name: str
+    input_flags: list[str]
+    want_output: list[str]
+    unwanted_output: list[str]
+
+
+ISOLATION_FLAGS = ["--benchmark_isolation=process", "--benchmark_timeout=1s"]
+
+TEST_COUNT = 7
+TESTS = [
+    Test(
+        "TestCrashIsRecorded",
+        ISOLATION_FLAGS,
+        ["Name BM_Crash\nError crashed with signal 11"],
+        [],
+    ),
+    Test(
+        "TestHangTimesOut",
+        ISOLATION_FLAGS,
+        ["Name BM_Hang\nError timed out after 1"],
+        [],
+    ),
+    Test(
+        "TestExitWithoutResultsIsRecorded",
+        ISOLATION_FLAGS,
+        ["Name BM_Exit\nError exited without sending results"],
+        [],
+    ),
+    Test(
+        "TestSuiteContinuesAfterFailure",
+        ISOLATION_FLAGS,
+        ["Name BM_VecPush\nCPU Time", "Name BM_ProcessState\nCPU Time"],
+        [],
+    ),
+    Test(
+        "TestPinCpu",
+        ISOLATION_FLAGS + ["--benchmark_pin_cpu=0"],
+        ["CPU affinity: 0\n"],
+        ["Warning: Failed to pin"],
+    ),
+    Test(
+        "TestHugePagesOn",
+        ISOLATION_FLAGS + ["--benchmark_huge_pages=True"],
+        ["Heap advised for huge pages: yes", "THP disabled: 0"],
+        ["Warning: Failed to advise huge pages"],
+    ),
+    Test(
+        "TestHugePagesOff",
+        ISOLATION_FLAGS + ["--benchmark_huge_pages=False"],
+        ["Heap advised for huge pages: no", "THP disabled: 1"],
+        ["Warning: Failed to disable transparent huge pages"],
+    ),
+]
+
+
+def test_isolation():
+    if len(sys.argv) != 2:
+        print(
+            "ERROR: wrong number of args. " "Only one arg expected: path/to/executable"
+        )
+        return -1
+    binary_under_test = sys.argv[1]
+    print(f"Test Isolation Integration. Using binary: {binary_under_test}")
+    passed = 0
+    for t in TESTS:
+        test_call = [binary_under_test] + t.input_flags
+        test_run = subprocess.run(test_call, capture_output=True, timeout=30)
+        got_stdout = test_run.stdout.decode()
+        missing = [w for w in t.want_output if w not in got_stdout]
+        missing += [f"not {w}" for w in t.unwanted_output if w in got_stdout]
+        if test_run.returncode != 0:
+            missing.append(f"exit status 0, got {test_run.returncode}")
+        if missing:
+            print(
+                f"Failed test {t.name}."
+                f" {test_call} got [{got_stdout}]."
+                f" Missing: {missing}."
+            )
+        else:
+            passed += 1
+    print(f"Test Isolation Integration. Passed {passed} out of {TEST_COUNT}")
+    return 0
+
+
+if __name__ == "__main__":
+    test_isolation()
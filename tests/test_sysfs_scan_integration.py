@@ -16,7 +16,7 @@ class Test:
     want_output: str
 
 
-TEST_COUNT = 2
+TEST_COUNT = 3
 TESTS = [
     Test(
         "TestSysFsIntelTurboOff",
@@ -30,6 +30,12 @@ TESTS = [
         "0",
         "Chip power frequency scaling is on",
     ),
+    Test(
+        "TestSysFsClocksourceNotTsc",
+        "sys/devices/system/clocksource/clocksource0/current_clocksource",
+        "hpet",
+        "Warning: TSC is not",
+    ),
 ]
 
 
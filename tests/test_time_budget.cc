@@ -0,0 +1,37 @@
+#include <stdint.h>
+
+#include "bm.hpp"
+
+// Two benchmarks with the same average work but different spread, run under a
+// time budget. Used to check the budget is kept, not which benchmark gets the
+// rounds. That depends on preemption noise; see test_time_budget_schedule.cc.
+
+static void Work(uint32_t n) {
+  volatile uint32_t sink = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    sink += i;
+  }
+}
+
+static void BM_LowNoise(BM::Controller &c) {
+  for (auto _ : c) {
+    Work(1000);
+  }
+}
+
+BM_Register(BM_LowNoise);
+
+static void BM_HighNoise(BM::Controller &c) {
+  static uint32_t state = 2463534242;
+  for (auto _ : c) {
+    // xorshift32, uniform work in [0, 2000)
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    Work(state % 2000);
+  }
+}
+
+BM_Register(BM_HighNoise);
+
+BM_Main();
@@ -0,0 +1,82 @@
+# Test Time Budget Integration
+
+from dataclasses import dataclass
+import re
+import subprocess
+import sys
+
+
+@dataclass
+class Test:
+    name: str
+    budget_seconds: float
+
+
+# WARNING: This test depends on timing. Keep an eye out for flakes.
+TEST_COUNT = 2
+TESTS = [
+    Test("TestOneSecondBudget", 1.0),
+    Test("TestHalfSecondBudget", 0.5),
+]
+
+# The scheduler hands out rounds of 5% of the budget, so it may overshoot by
+# about a round. It can't stop much earlier than the budget.
+# Which experiment gets each round is tested deterministically in
+# test_time_budget_schedule.cc.
+USED_LOWER_TOLERANCE = 0.95
+USED_UPPER_TOLERANCE = 1.25
+
+
+def parse_results(stdout):
+    results = {}
+    for block in stdout.split("Name ")[1:]:
+        name = block.split("\n", 1)[0]
+        cpu_time = re.search("CPU Time (\\d+)", block)
+        ci = re.search("95% CI \\+/- ([0-9.e+-]+)", block)
+        iterations = re.search("Iterations (\\d+)", block)
+        if cpu_time and ci and iterations:
+            results[name] = (
+                int(cpu_time.group(1)),
+                float(ci.group(1)),
+                int(iterations.group(1)),
+            )
+    return results
+
+
+def run_test(binary_under_test, t):
+    test_call = [binary_under_test, f"--benchmark_time_budget={t.budget_seconds}s"]
+    got_stdout = subprocess.run(test_call, capture_output=True).stdout.decode()
+    failures = []
+    used = re.search("used ([0-9.e+-]+) seconds", got_stdout)
+    if not used:
+        failures.append("no used time reported")
+    elif not (
+        USED_LOWER_TOLERANCE * t.budget_seconds
+        <= float(used.group(1))
+        <= USED_UPPER_TOLERANCE * t.budget_seconds
+    ):
+        failures.append(f"used {used.group(1)} seconds of {t.budget_seconds}")
+    results = parse_results(got_stdout)
+    if "BM_LowNoise" not in results or "BM_HighNoise" not in results:
+        failures.append("missing results")
+    if failures:
+        print(f"Failed test {t.name}. {test_call} got [{got_stdout}]. {failures}")
+        return False
+    return True
+
+
+def test_time_budget():
+    if len(sys.argv) != 2:
+        print(
+            "ERROR: wrong number of args. " "Only one arg expected: path/to/executable"
+        )
+        return -1
+    binary_under_test = sys.argv[1]
+    print(f"Test Time Budget Integration. Using binary: {binary_under_test}")
+    passed = sum(1 for t in TESTS if run_test(binary_under_test, t))
+    print(f"Test Time Budget Integration. Passed {passed} out of {TEST_COUNT}")
+    return 0
+
+
+if __name__ == "__main__":
+    test_time_budget()
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bm.hpp"
+
+// Tests the time budget scheduler's choice of experiment on hand built
+// experiments, independent of timing.
+
+static BM::Experiment MakeExperiment(const std::string &label, int64_t mean,
+                                     int64_t variance, int64_t iterations) {
+  BM::Experiment e(label);
+  e.mean_ = mean;
+  e.variance_ = variance;
+  e.iterations_ = iterations;
+  return e;
+}
+
+static int failures = 0;
+
+static void ExpectPick(const std::string &test_name,
+                       std::vector<BM::Scheduled> &schedule,
+                       const BM::Experiment *want) {
+  BM::Scheduled *got = BM::PickWidest(schedule);
+  const BM::Experiment *got_experiment = got ? got->experiment_ : nullptr;
+  if (got_experiment != want) {
+    std::cout << "Test Time Budget Schedule. Failed " << test_name << ". Got "
+              << (got_experiment ? got_experiment->label_ : "nullptr")
+              << ". Want " << (want ? want->label_ : "nullptr") << ".\n";
+    ++failures;
+  }
+}
+
+int main() {
+  // Same mean and iterations, so the higher variance is the wider relative CI.
+  BM::Experiment low_noise = MakeExperiment("low_noise", 1000, 100, 101);
+  BM::Experiment high_noise = MakeExperiment("high_noise", 1000, 330000, 101);
+  std::vector<BM::Scheduled> schedule = {
+      {nullptr, &low_noise, 0, false},
+      {nullptr, &high_noise, 0, false},
+  };
+  ExpectPick("TestPicksHigherVariance", schedule, &high_noise);
+
+  // Relative, not absolute: a 10x larger CI on a 100x larger mean is narrower.
+  BM::Experiment slow = MakeExperiment("slow", 100000, 33000000, 101);
+  BM::Experiment fast = MakeExperiment("fast", 1000, 330000, 101);
+  schedule = {{nullptr, &slow, 0, false}, {nullptr, &fast, 0, false}};
+  ExpectPick("TestPicksWiderRelativeCI", schedule, &fast);
+
+  // More iterations narrow the CI, so the less sampled experiment is picked.
+  BM::Experiment sampled = MakeExperiment("sampled", 1000, 330000, 100000);
+  BM::Experiment unsampled = MakeExperiment("unsampled", 1000, 330000, 101);
+  schedule = {{nullptr, &sampled, 0, false}, {nullptr, &unsampled, 0, false}};
+  ExpectPick("TestPicksFewerIterations", schedule, &unsampled);
+
+  // An experiment without a mean yet is infinitely imprecise.
+  BM::Experiment no_mean = MakeExperiment("no_mean", 0, 0, 1);
+  schedule = {{nullptr, &high_noise, 0, false}, {nullptr, &no_mean, 0, false}};
+  ExpectPick("TestPicksNoMean", schedule, &no_mean);
+
+  // Exhausted experiments are skipped, however wide.
+  schedule = {{nullptr, &low_noise, 0, false}, {nullptr, &high_noise, 0, true}};
+  ExpectPick("TestSkipsExhausted", schedule, &low_noise);
+
+  schedule = {{nullptr, &low_noise, 0, true}, {nullptr, &high_noise, 0, true}};
+  ExpectPick("TestAllExhausted", schedule, nullptr);
+
+  if (failures) {
+    return -1;
+  }
+  std::cout << "Test Time Budget Schedule. Passed\n";
+  return 0;
+}
@@ -9,20 +9,32 @@ import sys
 @dataclass
 class Test:
     name: str
+    input_flags: list[str]
     want_regexp_stdout: list[str]
 
 
 # WARNING: This test may be very flaky. Keep an eye out.
-TEST_COUNT = 1
+TEST_COUNT = 2
 TESTS = [
     Test(
         "TestNoOutputFlag",
+        [],
         [
             "BM_VecPush",
             "CPU Time [1-9]\\d* reference cycles",
             "Wall Time [0-9]\\d* milliseconds",
         ],
     ),
+    Test(
+        "TestTimeBudget",
+        ["--benchmark_time_budget=0.5s"],
+        [
+            "Time budget: 0.5 seconds",
+            "BM_VecPush",
+            "CPU Time [1-9]\\d* reference cycles",
+            "95% CI \\+/- [0-9.e+-]+ reference cycles",
+        ],
+    ),
 ]
 
 
@@ -36,7 +48,7 @@ def test_output_flags():
     print(f"Test Time Integration. Using binary: {binary_under_test}")
     passed = 0
     for t in TESTS:
-        test_call = [binary_under_test]
+        test_call = [binary_under_test] + t.input_flags
         test_run = subprocess.run(test_call, capture_output=True)
         got_stdout = test_run.stdout.decode()
         missing = []